@@ -1,6 +1,14 @@
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
 #include <vector>
+#include <algorithm>
+#include <unordered_map>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
 #include <random>
 #include <chrono>
 #include <thread>
@@ -24,6 +32,41 @@
 #define COHESION_FACTOR 100.0
 #define ALIGNMENT_FACTOR 8.0
 
+// Neighbor list parameters
+#define NEIGHBOR_SKIN 40.0
+
+// Flock analytics parameters
+#define CLUSTER_RADIUS 20.0
+#define NEAREST_BINS 10
+
+// Morton reordering parameters
+#define MORTON_BITS 10
+#define REORDER_INTERVAL 64
+#define REORDER_MIN_INTERVAL 8
+#define REORDER_MAX_INTERVAL 1024
+#define REORDER_WINDOW 16
+#define RADIX_PARALLEL_MIN 16384
+
+// Multi-rate update parameters
+#define MULTIRATE_MAX_INTERVAL 8
+#define MULTIRATE_ERROR_BUDGET 2.0
+#define MULTIRATE_NEAR_DISTANCE 150.0
+#define MULTIRATE_CROWD_SIZE 64.0
+
+// Compact storage parameters
+#define PACK_MARGIN 100.0
+#define WING_PHASE_STEP 0.75
+#define WING_PHASE_OFFSET 7.5
+
+// Boid pool parameters
+#define EMITTER_SPREAD 20.0
+
+// Open world parameters
+#define REGION_SIZE 1000.0
+#define PAGE_RADIUS 1500.0
+#define PAGE_HYSTERESIS 1.25
+#define PAGE_INTERVAL 30
+
 using namespace std;
 
 // ============================================================================
@@ -85,6 +128,7 @@ float distBetween(const vec3df& a, const vec3df& b) {
 // ============================================================================
 
 struct Boid {
+    int id;
     vec3df avgdirection;
     vec3df oldposition;
     vec3df position;
@@ -98,6 +142,25 @@ struct Boid {
     float bodyHeight;
 };
 
+// Refers to one boid for as long as it lives. The id is recycled after the
+// boid is killed, but the generation is not, so stale handles are detected.
+struct BoidHandle {
+    int id;
+    uint32_t generation;
+};
+
+// Compact boid: 16-bit fixed-point position inside the packing box, half
+// precision velocity, octahedral rotation axis (12+12 bits) with an 8-bit angle,
+// and a wing byte holding the rising flag and upper wing angle. Direction, old
+// position and the remaining wing angles are derived from these on unpack.
+struct PackedBoid {
+    int32_t id;
+    uint16_t position[3];
+    uint16_t velocity[3];
+    uint32_t orientation;
+    uint8_t wingPhase;
+};
+
 // ============================================================================
 // Global Variables
 // ============================================================================
@@ -133,13 +196,35 @@ Material orangeMaterial = {
     {0.0}
 };
 
-// Flock data
+// Flock data: a pool whose live boids are packed densely at the front
 int flockPopulation;
 vector<Boid> flockList;
+vector<int> boidIndex;            // boid id -> current position in flockList, -1 when free
+vector<uint32_t> boidGeneration;  // bumped each time an id is freed
+vector<int> freeIds;
+
+// Compact storage: when enabled the flock lives in packedList instead
+bool compactStorage = false;
+vector<PackedBoid> packedList;
+struct Packing {
+    vec3df origin;          // lower corner of the quantization box
+    float step;             // world units per position step
+    long rebases;
+    double positionErrorSq; // quantization error against the unpacked floats
+    double velocityErrorSq;
+    float positionErrorMax;
+    float velocityErrorMax;
+    long samples;
+    vector<vec3df> scratch;
+};
+Packing packing;
 
 // Behavior weights
 int m1 = 1, m2 = 0, m3 = 1;  // cohesion, attraction, velocity
 
+// Camera
+const vec3df cameraPosition(0.0, 0.0, 800.0);
+
 // Predator/attractor
 Boid predator;
 float modelAngle = 0.0;
@@ -151,69 +236,1211 @@ float lowerWingAngle = -45.0;
 bool pauseScene = false;
 float bodyHeight = 0.0;
 bool lightIsEnabled = true;
+long simTick = 0;
+
+// Neighbor lists (CSR: boid i's neighbors are indices[offsets[i]..offsets[i+1]))
+struct NeighborList {
+    vector<int> offsets;
+    vector<int> indices;
+    vector<vec3df> refPositions;   // positions when the lists were built
+    // Sparse grid used while building: an open-addressing hash from cell
+    // coordinates to occupied cells, whose boids are listed in CSR form
+    vector<uint64_t> slotKeys;
+    vector<int> slotCells;         // -1 for an empty slot
+    int slotBits;
+    vector<int> cellStart;
+    vector<int> cellBoids;
+    vector<int> cellOf;
+    vector<int> cellFill;
+    bool valid;
+    long builds;
+    long ticks;
+    double buildMs;                // cost of the last build
+};
+NeighborList neighbors;
+
+// Morton (Z-order) reordering of flockList
+struct MortonReorder {
+    bool adaptive;
+    int interval;
+    int ticksSince;
+    double earlyMs;         // rule-pass cost per list entry, summed over the first
+    double lateMs;          // ticks after a reorder and the last ticks before the next
+    double earlySq, lateSq; // and the sums of its squares
+    double sortMs;          // cost of the last reorder
+    long count;
+    vector<uint32_t> keys, keysTmp;
+    vector<int> order, orderTmp;
+    vector<size_t> counts;
+    vector<Boid> scratch;
+    vector<PackedBoid> packedScratch;
+};
+MortonReorder reorder;
+
+// Multi-rate updates: boids evaluate the rules every 1, 2, 4 or 8 ticks and
+// extrapolate their position in between
+struct BoidSchedule {
+    int interval;
+    long lastTick;
+};
+struct MultiRate {
+    bool enabled;
+    float errorBudget;          // tolerated extrapolation error, in world units
+    vector<BoidSchedule> schedule;  // indexed by boid id
+    long evaluations;
+    long skipped;
+};
+MultiRate multiRate;
+
+// Flock analytics, gathered from the neighbor scans of each update
+struct FlockMetrics {
+    int clusters;               // groups linked by boids within CLUSTER_RADIUS
+    int largestCluster;
+    float polarization;         // 1 when every boid heads the same way
+    float meanNearest;          // over boids with a neighbor inside CLUSTER_RADIUS
+    int nearestHistogram[NEAREST_BINS + 1];  // last bin: none inside CLUSTER_RADIUS
+};
+struct Analytics {
+    bool enabled;
+    vector<int> parent;         // union-find over this tick's flock slots
+    vector<int> size;
+    vector<float> nearestSq;
+    vector<vec3df> positions;   // flock at the start of the tick
+    vec3df heading;
+    FlockMetrics latest;
+    double onMs, offMs;         // update cost with and without analytics
+    long onTicks, offTicks;
+};
+Analytics analytics;
 
 // Boundary box
 const float xMin = -250.0, xMax = 250.0;
 const float yMin = -250.0, yMax = 250.0;
 const float zMin = 250.0, zMax = 700.0;
 
+// Open world: no boundary box, and regions away from the camera and predator
+// are paged out to packed boids keyed by region coordinates
+bool openWorld = false;
+struct RegionPaging {
+    unordered_map<uint64_t, vector<PackedBoid> > frozen;
+    long frozenBoids;
+    long pagedOut;
+    long pagedIn;
+};
+RegionPaging paging;
+
+// ============================================================================
+// Utility Functions
+// ============================================================================
+
+float randPoint(float min, float max) {
+    return ((float(rand()) / float(RAND_MAX)) * (max - min)) + min;
+}
+
+void setMaterial(const Material& material) {
+    glMaterialfv(GL_FRONT, GL_AMBIENT, material.ambient);
+    glMaterialfv(GL_FRONT, GL_DIFFUSE, material.diffuse);
+    glMaterialfv(GL_FRONT, GL_SPECULAR, material.specular);
+    glMaterialfv(GL_FRONT, GL_SHININESS, material.shininess);
+}
+
+void initLighting() {
+    glEnable(GL_LIGHT0);
+    glLightfv(GL_LIGHT0, GL_DIFFUSE, light_diff);
+    glLightfv(GL_LIGHT0, GL_AMBIENT, light_amb);
+    glLightfv(GL_LIGHT0, GL_SPECULAR, light_spec);
+    glShadeModel(GL_FLAT);
+}
+
+void updateLightPosition() {
+    glMatrixMode(GL_MODELVIEW);
+    glLightfv(GL_LIGHT0, GL_POSITION, light_pos);
+}
+
+// ============================================================================
+// Flock Initialization
+// ============================================================================
+
+Boid makeBoid(int id) {
+    Boid boid;
+    
+    // Random initial position
+    boid.position = vec3df(randPoint(xMin, xMax), 
+                           randPoint(yMin, yMax), 
+                           randPoint(zMin, zMax));
+    boid.oldposition = boid.position;
+    boid.velocity = vec3df(0.0, 0.0, 0.0);
+    
+    // Initial direction and rotation
+    boid.direction = vec3df(0.0, 0.0, 1.0);
+    boid.rotation = vec3df(0.0, 0.0, 0.0);
+    boid.angle = 0;
+    
+    // Wing animation state
+    boid.upperWingAngle = randPoint(0.0, MAX_WING_ANGLE);
+    boid.lowerWingAngle = (boid.upperWingAngle / MAX_WING_ANGLE) * 90.0 - 45.0;
+    boid.wingRise = (boid.upperWingAngle < WING_ANGLE_THRESHOLD);
+    
+    boid.id = id;
+    return boid;
+}
+
+void setupFlock(int population, unsigned seed) {
+    flockPopulation = population;
+    srand(seed);
+    
+    for(int i = 0; i < flockPopulation; ++i) {
+        flockList.push_back(makeBoid(i));
+        boidIndex.push_back(i);
+        boidGeneration.push_back(0);
+    }
+}
+
+// ============================================================================
+// Compact Storage
+// ============================================================================
+
+uint16_t floatToHalf(float f) {
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    uint16_t sign = (x >> 16) & 0x8000;
+    int exponent = int((x >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = x & 0x7fffff;
+    
+    if(exponent >= 31) {
+        return sign | 0x7bff;  // clamp to the largest finite half
+    }
+    if(exponent <= 0) {
+        if(exponent < -10) {
+            return sign;
+        }
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        uint16_t h = mantissa >> shift;
+        if((mantissa >> (shift - 1)) & 1) {
+            h++;
+        }
+        return sign | h;
+    }
+    
+    uint16_t h = sign | (exponent << 10) | (mantissa >> 13);
+    if(mantissa & 0x1000) {
+        h++;  // rounding may carry into the exponent, which is still correct
+    }
+    return h;
+}
+
+float halfToFloat(uint16_t h) {
+    uint32_t sign = uint32_t(h & 0x8000) << 16;
+    int exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    
+    if(exponent == 0) {
+        float f = ldexp(float(mantissa), -24);
+        return sign ? -f : f;
+    }
+    
+    uint32_t x = sign | (uint32_t(exponent - 15 + 127) << 23) | (mantissa << 13);
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+vec3df unpackPosition(const PackedBoid& pb, const vec3df& origin, float step) {
+    return origin + vec3df(pb.position[0], pb.position[1], pb.position[2]) * step;
+}
+
+vec3df unpackPosition(const PackedBoid& pb) {
+    return unpackPosition(pb, packing.origin, packing.step);
+}
+
+vec3df unpackVelocity(const PackedBoid& pb) {
+    return vec3df(halfToFloat(pb.velocity[0]), halfToFloat(pb.velocity[1]), halfToFloat(pb.velocity[2]));
+}
+
+uint16_t packCoordinate(float value, float origin, float step) {
+    float q = floor((value - origin) / step + 0.5);
+    return uint16_t(max(0.0f, min(65535.0f, q)));
+}
+
+bool insidePacking(const vec3df& p) {
+    float extent = packing.step * 65535.0;
+    vec3df d = p - packing.origin;
+    return d.x >= 0 && d.y >= 0 && d.z >= 0 && d.x <= extent && d.y <= extent && d.z <= extent;
+}
+
+uint32_t packOrientation(const vec3df& axis, float angle) {
+    // Octahedral mapping of the unit axis onto a square
+    float l1 = fabs(axis.x) + fabs(axis.y) + fabs(axis.z);
+    float u = l1 > 0 ? axis.x / l1 : 0.0;
+    float v = l1 > 0 ? axis.y / l1 : 0.0;
+    if(axis.z < 0) {
+        float fu = (1.0 - fabs(v)) * (u >= 0 ? 1.0 : -1.0);
+        float fv = (1.0 - fabs(u)) * (v >= 0 ? 1.0 : -1.0);
+        u = fu;
+        v = fv;
+    }
+    uint32_t qu = uint32_t((u * 0.5 + 0.5) * 4095.0 + 0.5);
+    uint32_t qv = uint32_t((v * 0.5 + 0.5) * 4095.0 + 0.5);
+    uint32_t qa = angle == angle ? uint32_t(max(0.0f, min(180.0f, angle)) / 180.0 * 255.0 + 0.5) : 0;
+    return (qu << 20) | (qv << 8) | qa;
+}
+
+void unpackOrientation(uint32_t packed, Boid& b) {
+    float u = ((packed >> 20) & 0xfff) / 4095.0 * 2.0 - 1.0;
+    float v = ((packed >> 8) & 0xfff) / 4095.0 * 2.0 - 1.0;
+    vec3df axis(u, v, 1.0 - fabs(u) - fabs(v));
+    if(axis.z < 0) {
+        axis.x = (1.0 - fabs(v)) * (u >= 0 ? 1.0 : -1.0);
+        axis.y = (1.0 - fabs(u)) * (v >= 0 ? 1.0 : -1.0);
+    }
+    b.rotation = axis.normalize();
+    b.angle = (packed & 0xff) / 255.0 * 180.0;
+}
+
+// Lower wing angle and body height follow from the upper angle, since all
+// three advance in lockstep from lower = upper * 4/3 - 45
+uint8_t packWings(const Boid& b) {
+    int q = int((b.upperWingAngle + WING_PHASE_OFFSET) / WING_PHASE_STEP + 0.5);
+    return (b.wingRise ? 0x80 : 0) | max(0, min(0x7f, q));
+}
+
+void unpackWings(uint8_t phase, Boid& b) {
+    b.wingRise = (phase & 0x80) != 0;
+    b.upperWingAngle = (phase & 0x7f) * WING_PHASE_STEP - WING_PHASE_OFFSET;
+    b.lowerWingAngle = b.upperWingAngle * 4.0 / 3.0 - 45.0;
+    b.bodyHeight = b.lowerWingAngle / 15;
+}
+
+// Packs b with positions measured in steps from origin
+void encodeBoid(const Boid& b, PackedBoid& pb, const vec3df& origin, float step) {
+    pb.id = b.id;
+    pb.position[0] = packCoordinate(b.position.x, origin.x, step);
+    pb.position[1] = packCoordinate(b.position.y, origin.y, step);
+    pb.position[2] = packCoordinate(b.position.z, origin.z, step);
+    pb.velocity[0] = floatToHalf(b.velocity.x);
+    pb.velocity[1] = floatToHalf(b.velocity.y);
+    pb.velocity[2] = floatToHalf(b.velocity.z);
+    pb.orientation = packOrientation(b.rotation.normalize(), b.angle);
+    pb.wingPhase = packWings(b);
+}
+
+Boid decodeBoid(const PackedBoid& pb, const vec3df& origin, float step) {
+    Boid b;
+    b.id = pb.id;
+    b.position = unpackPosition(pb, origin, step);
+    b.velocity = unpackVelocity(pb);
+    b.direction = b.velocity;
+    b.oldposition = b.position - b.velocity;
+    unpackOrientation(pb.orientation, b);
+    unpackWings(pb.wingPhase, b);
+    return b;
+}
+
+Boid unpackBoid(int i) {
+    return decodeBoid(packedList.at(i), packing.origin, packing.step);
+}
+
+// Fits the packing box around the boundary box and every given position
+void fitPacking(const vector<vec3df>& positions) {
+    vec3df lo(xMin, yMin, zMin), hi(xMax, yMax, zMax);
+    for(size_t i = 0; i < positions.size(); ++i) {
+        const vec3df& p = positions[i];
+        lo = vec3df(min(lo.x, p.x), min(lo.y, p.y), min(lo.z, p.z));
+        hi = vec3df(max(hi.x, p.x), max(hi.y, p.y), max(hi.z, p.z));
+    }
+    packing.origin = lo - vec3df(PACK_MARGIN, PACK_MARGIN, PACK_MARGIN);
+    float extent = max(hi.x - lo.x, max(hi.y - lo.y, hi.z - lo.z)) + 2.0 * PACK_MARGIN;
+    packing.step = extent / 65535.0;
+}
+
+// Refits the box so it also covers a boid that is about to leave it
+void rebasePacking(const vec3df& outside) {
+    vector<vec3df>& positions = packing.scratch;
+    positions.resize(flockPopulation);
+    for(int i = 0; i < flockPopulation; ++i) {
+        positions[i] = unpackPosition(packedList.at(i));
+    }
+    positions.push_back(outside);
+    fitPacking(positions);
+    for(int i = 0; i < flockPopulation; ++i) {
+        PackedBoid& pb = packedList.at(i);
+        pb.position[0] = packCoordinate(positions[i].x, packing.origin.x, packing.step);
+        pb.position[1] = packCoordinate(positions[i].y, packing.origin.y, packing.step);
+        pb.position[2] = packCoordinate(positions[i].z, packing.origin.z, packing.step);
+    }
+    packing.rebases++;
+}
+
+// Packs b into slot i and records how far the stored state drifts from it
+void packBoid(const Boid& b, int i) {
+    if(!insidePacking(b.position)) {
+        rebasePacking(b.position);
+    }
+    
+    PackedBoid& pb = packedList.at(i);
+    encodeBoid(b, pb, packing.origin, packing.step);
+    
+    float dp = distBetween(unpackPosition(pb), b.position);
+    float dv = distBetween(unpackVelocity(pb), b.velocity);
+    packing.positionErrorSq += dp * dp;
+    packing.velocityErrorSq += dv * dv;
+    packing.positionErrorMax = max(packing.positionErrorMax, dp);
+    packing.velocityErrorMax = max(packing.velocityErrorMax, dv);
+    packing.samples++;
+}
+
+void setCompactStorage(bool enabled) {
+    if(enabled == compactStorage) {
+        return;
+    }
+    
+    if(enabled) {
+        vector<vec3df> positions(flockPopulation);
+        for(int i = 0; i < flockPopulation; ++i) {
+            positions[i] = flockList.at(i).position;
+        }
+        fitPacking(positions);
+        packedList.resize(flockPopulation);
+        for(int i = 0; i < flockPopulation; ++i) {
+            packBoid(flockList.at(i), i);
+        }
+        flockList.clear();
+        flockList.shrink_to_fit();
+    }
+    else {
+        flockList.resize(flockPopulation);
+        for(int i = 0; i < flockPopulation; ++i) {
+            flockList.at(i) = unpackBoid(i);
+        }
+        packedList.clear();
+        packedList.shrink_to_fit();
+    }
+    compactStorage = enabled;
+}
+
+// Storage-independent access used by the rules and passes over the flock
+vec3df boidPosition(int i) {
+    return compactStorage ? unpackPosition(packedList.at(i)) : flockList.at(i).position;
+}
+
+vec3df boidVelocity(int i) {
+    return compactStorage ? unpackVelocity(packedList.at(i)) : flockList.at(i).velocity;
+}
+
+int boidId(int i) {
+    return compactStorage ? packedList.at(i).id : flockList.at(i).id;
+}
+
+Boid flockBoid(int i) {
+    return compactStorage ? unpackBoid(i) : flockList.at(i);
+}
+
+// ============================================================================
+// Boid Pool
+// ============================================================================
+
+// Grows every per-boid array geometrically, so steady churn stops allocating
+// once the pool has reached its high-water mark
+void reserveFlock(int capacity) {
+    size_t current = compactStorage ? packedList.capacity() : flockList.capacity();
+    if((size_t)capacity <= current) {
+        return;
+    }
+    
+    size_t size = max((size_t)capacity, 2 * current);
+    if(compactStorage) {
+        packedList.reserve(size);
+    }
+    else {
+        flockList.reserve(size);
+    }
+    boidIndex.reserve(size);
+    boidGeneration.reserve(size);
+    freeIds.reserve(size);
+    multiRate.schedule.reserve(size);
+}
+
+int allocateBoidId() {
+    if(!freeIds.empty()) {
+        int id = freeIds.back();
+        freeIds.pop_back();
+        return id;
+    }
+    boidIndex.push_back(-1);
+    boidGeneration.push_back(0);
+    return boidIndex.size() - 1;
+}
+
+// Places a boid whose id is already allocated at the end of the flock
+void appendBoid(const Boid& b) {
+    boidIndex[b.id] = flockPopulation;
+    if(compactStorage) {
+        packedList.push_back(PackedBoid());
+        packBoid(b, flockPopulation);
+    }
+    else {
+        flockList.push_back(b);
+    }
+    flockPopulation++;
+    neighbors.valid = false;
+}
+
+// Takes boid i out of the flock by moving the last boid into its place; the
+// caller decides what happens to its id
+void removeSlot(int i) {
+    int last = flockPopulation - 1;
+    
+    if(compactStorage) {
+        packedList[i] = packedList[last];
+        packedList.pop_back();
+    }
+    else {
+        flockList[i] = flockList[last];
+        flockList.pop_back();
+    }
+    flockPopulation--;
+    if(i != last) {
+        boidIndex[boidId(i)] = i;
+    }
+    neighbors.valid = false;
+}
+
+// Adds a batch of boids, scattered through the box or around an emitter
+void spawnBoids(int count, const vec3df* emitter = nullptr) {
+    reserveFlock(flockPopulation + count);
+    
+    for(int n = 0; n < count; ++n) {
+        int id = allocateBoidId();
+        Boid boid = makeBoid(id);
+        if(emitter) {
+            boid.position = *emitter + vec3df(randPoint(-EMITTER_SPREAD, EMITTER_SPREAD),
+                                              randPoint(-EMITTER_SPREAD, EMITTER_SPREAD),
+                                              randPoint(-EMITTER_SPREAD, EMITTER_SPREAD));
+            boid.oldposition = boid.position;
+        }
+        
+        if(id < (int)multiRate.schedule.size()) {
+            BoidSchedule fresh = {1, simTick};
+            multiRate.schedule[id] = fresh;
+        }
+        appendBoid(boid);
+    }
+}
+
+BoidHandle boidHandle(int i) {
+    int id = boidId(i);
+    BoidHandle h = {id, boidGeneration[id]};
+    return h;
+}
+
+// Returns the boid's current position in the flock, or -1 once it has died or
+// while its region is paged out
+int boidSlot(const BoidHandle& h) {
+    if(h.id < 0 || h.id >= (int)boidIndex.size() || boidGeneration[h.id] != h.generation) {
+        return -1;
+    }
+    return boidIndex[h.id];
+}
+
+void killBoidAt(int i) {
+    int id = boidId(i);
+    removeSlot(i);
+    boidIndex[id] = -1;
+    boidGeneration[id]++;
+    freeIds.push_back(id);
+}
+
+bool killBoid(const BoidHandle& h) {
+    int i = boidSlot(h);
+    if(i < 0) {
+        return false;
+    }
+    killBoidAt(i);
+    return true;
+}
+
+// Removes randomly chosen boids, always leaving at least two for the rules
+void killBoids(int count) {
+    count = min(count, flockPopulation - 2);
+    for(int n = 0; n < count; ++n) {
+        killBoidAt(rand() % flockPopulation);
+    }
+}
+
+// ============================================================================
+// Region Paging
+// ============================================================================
+
+// Packs signed cell coordinates into one key, 21 bits per axis
+uint64_t cellKey(int x, int y, int z) {
+    const uint64_t mask = (1 << 21) - 1;
+    return ((uint64_t(x + (1 << 20)) & mask) << 42) |
+           ((uint64_t(y + (1 << 20)) & mask) << 21) |
+           (uint64_t(z + (1 << 20)) & mask);
+}
+
+uint64_t regionKey(const vec3df& p) {
+    return cellKey(int(floor(p.x / REGION_SIZE)), int(floor(p.y / REGION_SIZE)),
+                   int(floor(p.z / REGION_SIZE)));
+}
+
+vec3df regionOrigin(uint64_t key) {
+    const uint64_t mask = (1 << 21) - 1;
+    return vec3df(float(int((key >> 42) & mask) - (1 << 20)),
+                  float(int((key >> 21) & mask) - (1 << 20)),
+                  float(int(key & mask) - (1 << 20))) * REGION_SIZE;
+}
+
+float distToRegion(const vec3df& p, const vec3df& lo) {
+    vec3df d(max(0.0f, max(lo.x - p.x, p.x - (lo.x + float(REGION_SIZE)))),
+             max(0.0f, max(lo.y - p.y, p.y - (lo.y + float(REGION_SIZE)))),
+             max(0.0f, max(lo.z - p.z, p.z - (lo.z + float(REGION_SIZE)))));
+    return d.length();
+}
+
+bool regionNear(uint64_t key, float radius) {
+    vec3df lo = regionOrigin(key);
+    return distToRegion(cameraPosition, lo) < radius || distToRegion(predator.position, lo) < radius;
+}
+
+void resumeRegion(vector<PackedBoid>& boids, uint64_t key) {
+    vec3df origin = regionOrigin(key);
+    reserveFlock(flockPopulation + boids.size());
+    for(size_t k = 0; k < boids.size(); ++k) {
+        appendBoid(decodeBoid(boids[k], origin, REGION_SIZE / 65535.0));
+    }
+    paging.frozenBoids -= boids.size();
+    paging.pagedIn += boids.size();
+}
+
+// Freezes boids in regions that nothing is looking at and resumes frozen
+// regions the camera or predator has come back to. Frozen boids keep their
+// id and generation, so handles to them are valid again once resumed.
+void pageRegions() {
+    // Walk backwards so the boid swapped into a freed slot was already checked
+    for(int i = flockPopulation - 1; i >= 0; --i) {
+        uint64_t key = regionKey(boidPosition(i));
+        if(regionNear(key, PAGE_RADIUS * PAGE_HYSTERESIS)) {
+            continue;
+        }
+        
+        Boid b = flockBoid(i);
+        PackedBoid pb;
+        encodeBoid(b, pb, regionOrigin(key), REGION_SIZE / 65535.0);
+        paging.frozen[key].push_back(pb);
+        boidIndex[b.id] = -1;
+        removeSlot(i);
+        paging.frozenBoids++;
+        paging.pagedOut++;
+    }
+    
+    for(unordered_map<uint64_t, vector<PackedBoid> >::iterator it = paging.frozen.begin();
+        it != paging.frozen.end(); ) {
+        if(regionNear(it->first, PAGE_RADIUS)) {
+            resumeRegion(it->second, it->first);
+            it = paging.frozen.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void setOpenWorld(bool enabled) {
+    openWorld = enabled;
+    if(!enabled) {
+        for(unordered_map<uint64_t, vector<PackedBoid> >::iterator it = paging.frozen.begin();
+            it != paging.frozen.end(); ++it) {
+            resumeRegion(it->second, it->first);
+        }
+        paging.frozen.clear();
+    }
+}
+
+// ============================================================================
+// Neighbor Lists
+// ============================================================================
+
+// Lists hold every boid within neighborCutoff(), and are reused until some pair
+// could have closed the skin.
+// Only relative motion matters, so displacements are measured from the flock's
+// mean displacement since the build: two boids can have closed in by at most
+// twice the largest such deviation. Boids are updated in place, so a neighbor
+// may already have taken this tick's step (at most MAX_VELOCITY) when it is
+// read; the lists stay exact while 2 * deviation + MAX_VELOCITY <= skin.
+bool neighborListStale() {
+    if(!neighbors.valid || (int)neighbors.refPositions.size() != flockPopulation) {
+        return true;
+    }
+    if(flockPopulation == 0) {
+        return false;
+    }
+    
+    vec3df shift;
+    for(int i = 0; i < flockPopulation; ++i) {
+        shift = shift + (boidPosition(i) - neighbors.refPositions.at(i));
+    }
+    shift = shift / flockPopulation;
+    
+    float limit = (NEIGHBOR_SKIN - MAX_VELOCITY) / 2.0;
+    float limitSq = limit * limit;
+    for(int i = 0; i < flockPopulation; ++i) {
+        vec3df d = boidPosition(i) - neighbors.refPositions.at(i) - shift;
+        if(dotproduct(d, d) > limitSq) {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+// COLLISION_RADIUS plus NEIGHBOR_SKIN, widened to CLUSTER_RADIUS while flock
+// analytics needs the pairs out to that distance
+float neighborCutoff() {
+    float radius = analytics.enabled ? max(COLLISION_RADIUS, CLUSTER_RADIUS) : COLLISION_RADIUS;
+    return radius + NEIGHBOR_SKIN;
+}
+
+// True when boid i was within the rules' own reach of boid j when the lists
+// were built; the lists hold more than that while analytics widens them
+bool withinReach(int j, int i) {
+    const float reach = COLLISION_RADIUS + NEIGHBOR_SKIN;
+    vec3df d = neighbors.refPositions[i] - neighbors.refPositions[j];
+    return dotproduct(d, d) < reach * reach;
+}
+
+// Returns the slot holding key, or the empty slot where it belongs
+int findCellSlot(uint64_t key) {
+    int mask = (1 << neighbors.slotBits) - 1;
+    int slot = int((key * 0x9E3779B97F4A7C15ull) >> (64 - neighbors.slotBits));
+    while(neighbors.slotCells[slot] >= 0 && neighbors.slotKeys[slot] != key) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void buildNeighborList() {
+    const float cutoff = neighborCutoff();
+    const float cutoffSq = cutoff * cutoff;
+    // Cells are sized for the widest cutoff either way, so each list keeps the
+    // same order whether or not analytics widens it and the rules sum their
+    // neighbors in the same order
+    const float cell = max(COLLISION_RADIUS, CLUSTER_RADIUS) + NEIGHBOR_SKIN;
+    
+    neighbors.offsets.assign(flockPopulation + 1, 0);
+    neighbors.indices.clear();
+    neighbors.refPositions.resize(flockPopulation);
+    if(flockPopulation == 0) {
+        neighbors.valid = true;
+        return;
+    }
+    
+    // Bin boids into cells; only occupied cells get an entry, so
+    // memory follows the number of boids rather than the space they cover
+    int bits = 1;
+    while((1 << bits) < 2 * flockPopulation) {
+        bits++;
+    }
+    neighbors.slotBits = bits;
+    neighbors.slotKeys.resize(1 << bits);
+    neighbors.slotCells.assign(1 << bits, -1);
+    neighbors.cellFill.clear();
+    
+    vector<int>& cellOf = neighbors.cellOf;
+    cellOf.resize(flockPopulation);
+    for(int i = 0; i < flockPopulation; ++i) {
+        neighbors.refPositions[i] = boidPosition(i);
+        const vec3df& p = neighbors.refPositions[i];
+        uint64_t key = cellKey(int(floor(p.x / cell)), int(floor(p.y / cell)), int(floor(p.z / cell)));
+        int slot = findCellSlot(key);
+        if(neighbors.slotCells[slot] < 0) {
+            neighbors.slotKeys[slot] = key;
+            neighbors.slotCells[slot] = neighbors.cellFill.size();
+            neighbors.cellFill.push_back(0);
+        }
+        cellOf[i] = neighbors.slotCells[slot];
+        neighbors.cellFill[cellOf[i]]++;
+    }
+    
+    int cells = neighbors.cellFill.size();
+    neighbors.cellStart.resize(cells + 1);
+    neighbors.cellStart[0] = 0;
+    for(int c = 0; c < cells; ++c) {
+        neighbors.cellStart[c + 1] = neighbors.cellStart[c] + neighbors.cellFill[c];
+        neighbors.cellFill[c] = neighbors.cellStart[c];
+    }
+    neighbors.cellBoids.resize(flockPopulation);
+    for(int i = 0; i < flockPopulation; ++i) {
+        neighbors.cellBoids[neighbors.cellFill[cellOf[i]]++] = i;
+    }
+    
+    // Gather each boid's neighbors from its own and the 26 surrounding cells
+    for(int i = 0; i < flockPopulation; ++i) {
+        const vec3df& p = neighbors.refPositions[i];
+        int cx = int(floor(p.x / cell));
+        int cy = int(floor(p.y / cell));
+        int cz = int(floor(p.z / cell));
+        
+        for(int z = cz - 1; z <= cz + 1; ++z) {
+            for(int y = cy - 1; y <= cy + 1; ++y) {
+                for(int x = cx - 1; x <= cx + 1; ++x) {
+                    int c = neighbors.slotCells[findCellSlot(cellKey(x, y, z))];
+                    if(c < 0) {
+                        continue;
+                    }
+                    for(int k = neighbors.cellStart[c]; k < neighbors.cellStart[c + 1]; ++k) {
+                        int j = neighbors.cellBoids[k];
+                        vec3df d = neighbors.refPositions[j] - p;
+                        if(j != i && dotproduct(d, d) < cutoffSq) {
+                            neighbors.indices.push_back(j);
+                        }
+                    }
+                }
+            }
+        }
+        neighbors.offsets[i + 1] = neighbors.indices.size();
+    }
+    
+    neighbors.valid = true;
+    neighbors.builds++;
+}
+
+void updateNeighborList() {
+    neighbors.ticks++;
+    if(neighborListStale()) {
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        buildNeighborList();
+        neighbors.buildMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    }
+}
+
+// ============================================================================
+// Morton Reordering
+// ============================================================================
+
+// Spreads the low 10 bits of v so there are two zero bits between each
+uint32_t spreadBits(uint32_t v) {
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+uint32_t mortonCode(const vec3df& p, const vec3df& lo, float scale) {
+    uint32_t x = uint32_t((p.x - lo.x) * scale);
+    uint32_t y = uint32_t((p.y - lo.y) * scale);
+    uint32_t z = uint32_t((p.z - lo.z) * scale);
+    return spreadBits(x) | (spreadBits(y) << 1) | (spreadBits(z) << 2);
+}
+
+template<typename F>
+void parallelFor(int threads, F f) {
+    if(threads == 1) {
+        f(0);
+        return;
+    }
+    vector<thread> pool;
+    for(int t = 0; t < threads; ++t) {
+        pool.push_back(thread(f, t));
+    }
+    for(int t = 0; t < threads; ++t) {
+        pool[t].join();
+    }
+}
+
+// LSD radix sort of reorder.order by reorder.keys, 8 bits per pass. Each thread
+// histograms and scatters its own contiguous chunk, so the sort is stable.
+void radixSortOrder(int keyBits) {
+    int n = reorder.keys.size();
+    int threads = 1;
+    if(n >= RADIX_PARALLEL_MIN) {
+        threads = max(1, (int)thread::hardware_concurrency());
+    }
+    int chunk = (n + threads - 1) / threads;
+    
+    reorder.keysTmp.resize(n);
+    reorder.orderTmp.resize(n);
+    reorder.counts.resize(threads * 256);
+    
+    for(int shift = 0; shift < keyBits; shift += 8) {
+        vector<uint32_t>& keys = reorder.keys;
+        vector<int>& order = reorder.order;
+        vector<size_t>& counts = reorder.counts;
+        
+        parallelFor(threads, [&](int t) {
+            size_t* c = &counts[t * 256];
+            fill(c, c + 256, 0);
+            for(int i = t * chunk; i < min(n, (t + 1) * chunk); ++i) {
+                c[(keys[i] >> shift) & 0xff]++;
+            }
+        });
+        
+        size_t sum = 0;
+        for(int d = 0; d < 256; ++d) {
+            for(int t = 0; t < threads; ++t) {
+                size_t c = counts[t * 256 + d];
+                counts[t * 256 + d] = sum;
+                sum += c;
+            }
+        }
+        
+        parallelFor(threads, [&](int t) {
+            size_t* c = &counts[t * 256];
+            for(int i = t * chunk; i < min(n, (t + 1) * chunk); ++i) {
+                size_t dst = c[(keys[i] >> shift) & 0xff]++;
+                reorder.keysTmp[dst] = keys[i];
+                reorder.orderTmp[dst] = order[i];
+            }
+        });
+        
+        keys.swap(reorder.keysTmp);
+        order.swap(reorder.orderTmp);
+    }
+}
+
+// Moves boid order[k] to slot k and keeps the id mapping in step
+void applyFlockOrder(const vector<int>& order) {
+    if(compactStorage) {
+        reorder.packedScratch.resize(flockPopulation);
+        for(int k = 0; k < flockPopulation; ++k) {
+            reorder.packedScratch[k] = packedList.at(order[k]);
+            boidIndex.at(reorder.packedScratch[k].id) = k;
+        }
+        packedList.swap(reorder.packedScratch);
+    }
+    else {
+        reorder.scratch.resize(flockPopulation);
+        for(int k = 0; k < flockPopulation; ++k) {
+            reorder.scratch[k] = flockList.at(order[k]);
+            boidIndex.at(reorder.scratch[k].id) = k;
+        }
+        flockList.swap(reorder.scratch);
+    }
+    neighbors.valid = false;
+}
+
+void mortonReorderFlock() {
+    if(flockPopulation == 0) {
+        return;
+    }
+    
+    vec3df lo = boidPosition(0), hi = lo;
+    for(int i = 0; i < flockPopulation; ++i) {
+        vec3df p = boidPosition(i);
+        lo = vec3df(min(lo.x, p.x), min(lo.y, p.y), min(lo.z, p.z));
+        hi = vec3df(max(hi.x, p.x), max(hi.y, p.y), max(hi.z, p.z));
+    }
+    float extent = max(hi.x - lo.x, max(hi.y - lo.y, hi.z - lo.z));
+    float scale = extent > 0 ? ((1 << MORTON_BITS) - 1) / extent : 0.0;
+    
+    reorder.keys.resize(flockPopulation);
+    reorder.order.resize(flockPopulation);
+    for(int i = 0; i < flockPopulation; ++i) {
+        reorder.keys[i] = mortonCode(boidPosition(i), lo, scale);
+        reorder.order[i] = i;
+    }
+    
+    radixSortOrder(3 * MORTON_BITS);
+    applyFlockOrder(reorder.order);
+    reorder.count++;
+}
+
+// Called once per tick with the cost of that tick's rule pass, which leaves out
+// the list rebuild every reorder forces. Locality decays as boids move, so the
+// cost creeps up after each reorder. The cost is taken per neighbor-list entry,
+// since list sizes follow the flock's density rather than its memory order. In
+// adaptive mode the mean over the last ticks before a reorder is compared with
+// the mean over the first ticks after the previous one, and the interval is
+// steered so the slowdown summed over the interval stays close to the cost of
+// a reorder and its rebuild. A slowdown within three standard errors counts
+// as none, so timing noise lengthens the interval instead of shortening it.
+void updateMortonOrder(double ruleMs) {
+    int window = max(2, min(REORDER_WINDOW, reorder.interval / 4));
+    double entries = max(1.0, double(neighbors.indices.size() + flockPopulation));
+    double cost = ruleMs / entries;
+    reorder.ticksSince++;
+    if(reorder.ticksSince <= window) {
+        reorder.earlyMs += cost;
+        reorder.earlySq += cost * cost;
+    }
+    else if(reorder.ticksSince > reorder.interval - window) {
+        reorder.lateMs += cost;
+        reorder.lateSq += cost * cost;
+    }
+    
+    if(reorder.ticksSince < reorder.interval) {
+        return;
+    }
+    
+    if(reorder.adaptive && reorder.count > 0) {
+        double early = reorder.earlyMs / window;
+        double late = reorder.lateMs / window;
+        double variance = (reorder.earlySq / window - early * early) + (reorder.lateSq / window - late * late);
+        double slowdown = late - early;
+        if(slowdown * slowdown <= 9.0 * max(0.0, variance) / (window - 1)) {
+            slowdown = 0.0;
+        }
+        
+        // The slowdown grows roughly linearly, so over the interval it adds up
+        // to about half the final per-tick slowdown times the interval
+        double lossMs = slowdown * entries * reorder.interval / 2.0;
+        double costMs = reorder.sortMs + neighbors.buildMs;
+        if(lossMs > 2.0 * costMs) {
+            reorder.interval = max(REORDER_MIN_INTERVAL, reorder.interval / 2);
+        }
+        else if(lossMs < 0.5 * costMs) {
+            reorder.interval = min(REORDER_MAX_INTERVAL, reorder.interval * 2);
+        }
+    }
+    
+    chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+    mortonReorderFlock();
+    reorder.sortMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    
+    reorder.ticksSince = 0;
+    reorder.earlyMs = reorder.earlySq = 0.0;
+    reorder.lateMs = reorder.lateSq = 0.0;
+}
+
+// ============================================================================
+// Multi-rate Scheduling
+// ============================================================================
+
+bool scheduledThisTick(const Boid& b) {
+    if(!multiRate.enabled) {
+        return true;
+    }
+    if((int)multiRate.schedule.size() <= b.id) {
+        BoidSchedule fresh = {1, simTick};
+        multiRate.schedule.resize(boidIndex.size(), fresh);
+    }
+    
+    // Offsetting by id spreads each tier's evaluations evenly across ticks
+    return (simTick + b.id) % multiRate.schedule[b.id].interval == 0;
+}
+
+// Ticks since the boid last ran the rules, which its next rule update stands in
+// for. Capped so a boid resumed after a long pause does not get one huge step.
+int elapsedTicks(const Boid& b) {
+    if(!multiRate.enabled) {
+        return 1;
+    }
+    long elapsed = simTick - multiRate.schedule[b.id].lastTick;
+    return int(max(1L, min(long(MULTIRATE_MAX_INTERVAL), elapsed)));
+}
+
+// Picks the longest interval whose extrapolation error stays within the boid's
+// share of the budget. Error grows with the square of the interval at the rate
+// the velocity has been changing; boids near the predator or camera always run
+// every tick, and crowded boids get a tighter tolerance.
+void scheduleBoid(const Boid& b, int i, const vec3df& oldVelocity) {
+    BoidSchedule& s = multiRate.schedule[b.id];
+    float accel = distBetween(b.velocity, oldVelocity) / elapsedTicks(b);
+    s.lastTick = simTick;
+    
+    float dist = min(distBetween(b.position, predator.position),
+                     distBetween(b.position, cameraPosition));
+    if(dist < MULTIRATE_NEAR_DISTANCE) {
+        s.interval = 1;
+        return;
+    }
+    
+    // Crowding counts the list entries the rules alone would keep, so widening
+    // the lists for analytics does not change the schedule
+    int crowd = 0;
+    for(int k = neighbors.offsets.at(i); k < neighbors.offsets.at(i + 1); ++k) {
+        if(withinReach(i, neighbors.indices[k])) {
+            crowd++;
+        }
+    }
+    float tolerance = multiRate.errorBudget * (dist / MULTIRATE_NEAR_DISTANCE)
+                    / (1.0 + crowd / MULTIRATE_CROWD_SIZE);
+    
+    s.interval = 1;
+    while(s.interval < MULTIRATE_MAX_INTERVAL &&
+          accel * (2 * s.interval) * (2 * s.interval) / 2.0 <= tolerance) {
+        s.interval *= 2;
+    }
+}
+
 // ============================================================================
-// Utility Functions
+// Flock Analytics
 // ============================================================================
 
-float randPoint(float min, float max) {
-    return ((float(rand()) / float(RAND_MAX)) * (max - min)) + min;
+// The lists are rebuilt with the cutoff analytics needs, or without it
+void setAnalytics(bool enabled) {
+    analytics.enabled = enabled;
+    neighbors.valid = false;
 }
 
-void setMaterial(const Material& material) {
-    glMaterialfv(GL_FRONT, GL_AMBIENT, material.ambient);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, material.diffuse);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, material.specular);
-    glMaterialfv(GL_FRONT, GL_SHININESS, material.shininess);
+void beginAnalytics() {
+    analytics.parent.resize(flockPopulation);
+    analytics.size.assign(flockPopulation, 1);
+    analytics.nearestSq.assign(flockPopulation, CLUSTER_RADIUS * CLUSTER_RADIUS);
+    analytics.positions.resize(flockPopulation);
+    for(int i = 0; i < flockPopulation; ++i) {
+        analytics.parent[i] = i;
+        analytics.positions[i] = boidPosition(i);
+    }
+    analytics.heading = vec3df();
 }
 
-void initLighting() {
-    glEnable(GL_LIGHT0);
-    glLightfv(GL_LIGHT0, GL_DIFFUSE, light_diff);
-    glLightfv(GL_LIGHT0, GL_AMBIENT, light_amb);
-    glLightfv(GL_LIGHT0, GL_SPECULAR, light_spec);
-    glShadeModel(GL_FLAT);
+int findCluster(int i) {
+    while(analytics.parent[i] != i) {
+        analytics.parent[i] = analytics.parent[analytics.parent[i]];
+        i = analytics.parent[i];
+    }
+    return i;
 }
 
-void updateLightPosition() {
-    glMatrixMode(GL_MODELVIEW);
-    glLightfv(GL_LIGHT0, GL_POSITION, light_pos);
+void joinClusters(int a, int b) {
+    a = findCluster(a);
+    b = findCluster(b);
+    if(a == b) {
+        return;
+    }
+    if(analytics.size[a] < analytics.size[b]) {
+        swap(a, b);
+    }
+    analytics.parent[b] = a;
+    analytics.size[a] += analytics.size[b];
 }
 
-// ============================================================================
-// Flock Initialization
-// ============================================================================
+// Called for each neighbor-list entry as boid j scans it. Boids move in place
+// during the scan, so offsets come from the start-of-tick snapshot and every
+// pair is measured at the same moment from both ends.
+void recordNeighbor(int j, int i) {
+    vec3df offset = analytics.positions[i] - analytics.positions[j];
+    float distSq = dotproduct(offset, offset);
+    if(distSq < CLUSTER_RADIUS * CLUSTER_RADIUS) {
+        analytics.nearestSq[j] = min(analytics.nearestSq[j], distSq);
+        joinClusters(i, j);
+    }
+}
 
-void setupFlock(int population) {
-    flockPopulation = population;
-    srand(time(NULL));
+// Neighbor scan for boids that skip the rules this tick, so multi-rate updates
+// do not drop their links
+void analyzeNeighbors(int j) {
+    for(int k = neighbors.offsets.at(j); k < neighbors.offsets.at(j + 1); ++k) {
+        recordNeighbor(j, neighbors.indices.at(k));
+    }
+}
+
+void finishAnalytics() {
+    FlockMetrics m = {};
+    int measured = 0;
+    double nearestSum = 0.0;
     
     for(int i = 0; i < flockPopulation; ++i) {
-        Boid boid;
-        
-        // Random initial position
-        boid.position = vec3df(randPoint(xMin, xMax), 
-                               randPoint(yMin, yMax), 
-                               randPoint(zMin, zMax));
-        boid.oldposition = boid.position;
-        boid.velocity = vec3df(0.0, 0.0, 0.0);
-        
-        // Initial direction and rotation
-        boid.direction = vec3df(0.0, 0.0, 1.0);
-        boid.rotation = vec3df(0.0, 0.0, 0.0);
-        boid.angle = 0;
-        
-        // Wing animation state
-        boid.upperWingAngle = randPoint(0.0, MAX_WING_ANGLE);
-        boid.lowerWingAngle = (boid.upperWingAngle / MAX_WING_ANGLE) * 90.0 - 45.0;
-        boid.wingRise = (boid.upperWingAngle < WING_ANGLE_THRESHOLD);
+        if(findCluster(i) == i) {
+            m.clusters++;
+            m.largestCluster = max(m.largestCluster, analytics.size[i]);
+        }
         
-        flockList.push_back(boid);
+        float nearest = sqrt(analytics.nearestSq[i]);
+        if(nearest < CLUSTER_RADIUS) {
+            m.nearestHistogram[int(nearest / CLUSTER_RADIUS * NEAREST_BINS)]++;
+            nearestSum += nearest;
+            measured++;
+        }
+        else {
+            m.nearestHistogram[NEAREST_BINS]++;
+        }
+    }
+    
+    m.polarization = flockPopulation > 0 ? analytics.heading.length() / flockPopulation : 0.0;
+    m.meanNearest = measured > 0 ? nearestSum / measured : 0.0;
+    analytics.latest = m;
+}
+
+// ============================================================================
+// Statistics
+// ============================================================================
+
+void printStats() {
+    std::cout << "Boid pool: " << flockPopulation << " live, "
+              << (compactStorage ? packedList.capacity() : flockList.capacity()) << " capacity, "
+              << freeIds.size() << " free ids" << std::endl;
+    
+    std::cout << (openWorld ? "Open world: " : "Bounded world: ")
+              << neighbors.cellFill.size() << " occupied cells in a "
+              << neighbors.slotCells.size() << " slot hash";
+    if(openWorld) {
+        std::cout << ", " << paging.frozen.size() << " frozen regions holding "
+                  << paging.frozenBoids << " boids (" << paging.frozenBoids * sizeof(PackedBoid)
+                  << " bytes), " << paging.pagedOut << " paged out, " << paging.pagedIn << " paged in";
+    }
+    std::cout << std::endl;
+    
+    std::cout << "Neighbor lists: " << neighbors.builds << " rebuilds in "
+              << neighbors.ticks << " ticks";
+    if(neighbors.builds > 0) {
+        std::cout << " (every " << float(neighbors.ticks) / neighbors.builds << " ticks, reused on "
+                  << 100.0 * (neighbors.ticks - neighbors.builds) / neighbors.ticks << "% of ticks)";
+    }
+    if(flockPopulation > 0) {
+        std::cout << ", " << float(neighbors.indices.size()) / flockPopulation
+                  << " neighbors/boid";
+    }
+    std::cout << std::endl;
+    
+    std::cout << "Morton reorder: " << reorder.count << " reorders, every "
+              << reorder.interval << " ticks (" << (reorder.adaptive ? "adaptive" : "fixed")
+              << "), last took " << reorder.sortMs << " ms plus a "
+              << neighbors.buildMs << " ms list rebuild" << std::endl;
+    
+    if(compactStorage) {
+        std::cout << "Compact storage: " << sizeof(PackedBoid) << " bytes/boid (full "
+                  << sizeof(Boid) << "), " << packing.rebases << " box refits";
+        if(packing.samples > 0) {
+            std::cout << ", quantization error position rms "
+                      << sqrt(packing.positionErrorSq / packing.samples)
+                      << " max " << packing.positionErrorMax
+                      << ", velocity rms " << sqrt(packing.velocityErrorSq / packing.samples)
+                      << " max " << packing.velocityErrorMax;
+        }
+        std::cout << std::endl;
+    }
+    else {
+        std::cout << "Full storage: " << sizeof(Boid) << " bytes/boid" << std::endl;
+    }
+    
+    if(analytics.enabled) {
+        const FlockMetrics& m = analytics.latest;
+        std::cout << "Flock: " << m.clusters << " clusters (largest " << m.largestCluster
+                  << "), polarization " << m.polarization
+                  << ", mean nearest neighbor " << m.meanNearest << std::endl;
+        std::cout << "Nearest neighbor histogram (" << CLUSTER_RADIUS / NEAREST_BINS << " unit bins):";
+        for(int b = 0; b <= NEAREST_BINS; ++b) {
+            std::cout << " " << m.nearestHistogram[b];
+        }
+        std::cout << std::endl;
+    }
+    if(analytics.onTicks > 0 && analytics.offTicks > 0) {
+        std::cout << "Update cost " << analytics.onMs / analytics.onTicks << " ms/tick with analytics, "
+                  << analytics.offMs / analytics.offTicks << " ms/tick without" << std::endl;
+    }
+    
+    if(multiRate.enabled) {
+        int tiers[MULTIRATE_MAX_INTERVAL + 1] = {0};
+        for(int i = 0; i < flockPopulation; ++i) {
+            int id = boidId(i);
+            if(id < (int)multiRate.schedule.size()) {
+                tiers[multiRate.schedule[id].interval]++;
+            }
+        }
+        std::cout << "Multi-rate (budget " << multiRate.errorBudget << "):";
+        for(int t = 1; t <= MULTIRATE_MAX_INTERVAL; t *= 2) {
+            std::cout << " every " << t << ": " << tiers[t];
+        }
+        long total = multiRate.evaluations + multiRate.skipped;
+        if(total > 0) {
+            std::cout << ", " << 100.0 * multiRate.skipped / total << "% extrapolated";
+        }
+        std::cout << std::endl;
     }
 }
 
@@ -221,16 +1448,34 @@ void setupFlock(int population) {
 // Flock Behavior
 // ============================================================================
 
+// In an open world, cohesion and alignment only look at the boids within the
+// rules' reach, so flocks far apart leave each other alone
 vec3df flockCentering(const Boid& bj, int j) {
     vec3df pcj;
-    
-    for(int i = 0; i < flockPopulation; ++i) {
-        if(j != i) {
-            pcj = pcj + flockList.at(i).position;
+    int count = 0;
+    
+    if(openWorld) {
+        for(int k = neighbors.offsets.at(j); k < neighbors.offsets.at(j + 1); ++k) {
+            int i = neighbors.indices.at(k);
+            if(withinReach(j, i)) {
+                pcj = pcj + boidPosition(i);
+                count++;
+            }
+        }
+    }
+    else {
+        for(int i = 0; i < flockPopulation; ++i) {
+            if(j != i) {
+                pcj = pcj + boidPosition(i);
+            }
         }
+        count = flockPopulation - 1;
+    }
+    if(count == 0) {
+        return vec3df();
     }
     
-    pcj = pcj / (flockPopulation - 1);
+    pcj = pcj / count;
     
     return (pcj - bj.position) / COHESION_FACTOR;
 }
@@ -238,11 +1483,14 @@ vec3df flockCentering(const Boid& bj, int j) {
 vec3df collisionAvoidance(const Boid& bj, int j) {
     vec3df c;
     
-    for(int i = 0; i < flockPopulation; ++i) {
-        if(j != i) {
-            if(distBetween(flockList.at(i).position, bj.position) < COLLISION_RADIUS) {
-                c = c - (flockList.at(i).position - bj.position);
-            }
+    for(int k = neighbors.offsets.at(j); k < neighbors.offsets.at(j + 1); ++k) {
+        int i = neighbors.indices.at(k);
+        vec3df p = boidPosition(i);
+        if(distBetween(p, bj.position) < COLLISION_RADIUS) {
+            c = c - (p - bj.position);
+        }
+        if(analytics.enabled) {
+            recordNeighbor(j, i);
         }
     }
     
@@ -251,14 +1499,30 @@ vec3df collisionAvoidance(const Boid& bj, int j) {
 
 vec3df velocityMatching(const Boid& bj, int j) {
     vec3df pvj;
-    
-    for(int i = 0; i < flockPopulation; ++i) {
-        if(j != i) {
-            pvj = pvj + flockList.at(i).velocity;
+    int count = 0;
+    
+    if(openWorld) {
+        for(int k = neighbors.offsets.at(j); k < neighbors.offsets.at(j + 1); ++k) {
+            int i = neighbors.indices.at(k);
+            if(withinReach(j, i)) {
+                pvj = pvj + boidVelocity(i);
+                count++;
+            }
+        }
+    }
+    else {
+        for(int i = 0; i < flockPopulation; ++i) {
+            if(j != i) {
+                pvj = pvj + boidVelocity(i);
+            }
         }
+        count = flockPopulation - 1;
+    }
+    if(count == 0) {
+        return vec3df();
     }
     
-    pvj = pvj / (flockPopulation - 1);
+    pvj = pvj / count;
     
     return (pvj - bj.velocity) / ALIGNMENT_FACTOR;
 }
@@ -274,6 +1538,9 @@ vec3df limit_velocity(Boid& b) {
 vec3df bound_position(const Boid& b) {
     vec3df v;
     
+    if(openWorld) {
+        return v;
+    }
     if(b.position.x < xMin) {
         v.x = 3.0;
     }
@@ -308,9 +1575,42 @@ vec3df tend_to_place(const Boid& b) {
 
 void updateBoids() {
     vec3df v1, v2, v3, v4, v5;
+    chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+    
+    if(openWorld && simTick % PAGE_INTERVAL == 0) {
+        pageRegions();
+    }
+    updateNeighborList();
+    if(analytics.enabled) {
+        beginAnalytics();
+    }
     
+    chrono::high_resolution_clock::time_point rulesStart = chrono::high_resolution_clock::now();
     for(int i = 0; i < flockPopulation; ++i) {
-        Boid& b = flockList.at(i);
+        Boid unpacked;
+        if(compactStorage) {
+            unpacked = unpackBoid(i);
+        }
+        Boid& b = compactStorage ? unpacked : flockList.at(i);
+        
+        if(!scheduledThisTick(b)) {
+            // The boundary still turns boids back between evaluations
+            b.velocity = b.velocity + bound_position(b);
+            limit_velocity(b);
+            b.oldposition = b.position;
+            b.position = b.position + b.velocity;
+            b.direction = b.position - b.oldposition;
+            multiRate.skipped++;
+            if(analytics.enabled) {
+                analyzeNeighbors(i);
+            }
+            if(compactStorage) {
+                packBoid(b, i);
+            }
+            continue;
+        }
+        vec3df oldVelocity = b.velocity;
+        int elapsed = elapsedTicks(b);
         
         v1 = flockCentering(b, i) * m1;
         v2 = collisionAvoidance(b, i);
@@ -318,29 +1618,73 @@ void updateBoids() {
         v4 = bound_position(b);
         v5 = tend_to_place(b) * m2;
         
-        b.velocity = b.velocity + v1 + v2 + v3 + v4 + v5;
+        // A boid on a slower tier applies the rules for every tick it skipped;
+        // the boundary was already applied on those ticks
+        b.velocity = b.velocity + (v1 + v2 + v3 + v5) * elapsed + v4;
         b.velocity = limit_velocity(b) * m3;
         
         b.oldposition = b.position;
         b.position = b.position + b.velocity;
         b.direction = b.position - b.oldposition;
+        
+        if(multiRate.enabled) {
+            scheduleBoid(b, i, oldVelocity);
+            multiRate.evaluations++;
+        }
+        if(compactStorage) {
+            packBoid(b, i);
+        }
     }
+    double ruleMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - rulesStart).count();
     
-    // Update average direction and rotation
+    // Update average direction and rotation (packed boids keep no separate
+    // direction; it is always the velocity of their last step)
     vec3df avgDir;
     for(int i = 0; i < flockPopulation; ++i) {
-        avgDir = avgDir + flockList.at(i).direction;
+        avgDir = avgDir + (compactStorage ? boidVelocity(i) : flockList.at(i).direction);
+    }
+    if(flockPopulation > 0) {
+        avgDir = avgDir / flockPopulation;
     }
-    avgDir = avgDir / flockPopulation;
 
     for(int i = 0; i < flockPopulation; ++i) {
-        vec3df olddir = flockList.at(i).direction;
-        vec3df newdir = avgDir * COHESION_FACTOR - flockList.at(i).oldposition;
-        flockList.at(i).avgdirection = avgDir * COHESION_FACTOR;
-        flockList.at(i).rotation = crossproduct(olddir, newdir);
-        flockList.at(i).angle = dotproduct(olddir, newdir) / (olddir.length() * newdir.length());
-        flockList.at(i).angle = acos(flockList.at(i).angle) * (180.0 / PI);
+        Boid unpacked;
+        if(compactStorage) {
+            unpacked = unpackBoid(i);
+        }
+        Boid& b = compactStorage ? unpacked : flockList.at(i);
+        
+        vec3df olddir = b.direction;
+        vec3df newdir = avgDir * COHESION_FACTOR - b.oldposition;
+        b.avgdirection = avgDir * COHESION_FACTOR;
+        b.rotation = crossproduct(olddir, newdir);
+        b.angle = dotproduct(olddir, newdir) / (olddir.length() * newdir.length());
+        b.angle = acos(b.angle) * (180.0 / PI);
+        
+        if(compactStorage) {
+            packedList.at(i).orientation = packOrientation(b.rotation.normalize(), b.angle);
+        }
+        if(analytics.enabled) {
+            analytics.heading = analytics.heading + olddir.normalize();
+        }
+    }
+    
+    if(analytics.enabled) {
+        finishAnalytics();
+    }
+    
+    double tickMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    if(analytics.enabled) {
+        analytics.onMs += tickMs;
+        analytics.onTicks++;
+    }
+    else {
+        analytics.offMs += tickMs;
+        analytics.offTicks++;
     }
+    
+    updateMortonOrder(ruleMs);
+    simTick++;
 }
 
 // ============================================================================
@@ -481,11 +1825,11 @@ void drawTail() {
              vec3df(width, height, depth), vec3df(-width, height, depth));
 }
 
-void drawBoid(int i, bool inFlock) {
+void drawBoid(const Boid& boid, bool inFlock) {
     // Translating body and wings
     glPushMatrix();
     if(inFlock) {
-        glTranslatef(0.0, flockList.at(i).bodyHeight, 0.0);
+        glTranslatef(0.0, boid.bodyHeight, 0.0);
     }
     else {
         glTranslatef(0.0, bodyHeight, 0.0);
@@ -495,7 +1839,7 @@ void drawBoid(int i, bool inFlock) {
     glPushMatrix();
     glTranslatef(3.0, 0.0, 0.0);
     if(inFlock) {
-        glRotatef(flockList.at(i).upperWingAngle, 0.0, 0.0, 1.0);
+        glRotatef(boid.upperWingAngle, 0.0, 0.0, 1.0);
     }
     else {
         glRotatef(upperWingAngle, 0.0, 0.0, 1.0);
@@ -504,7 +1848,7 @@ void drawBoid(int i, bool inFlock) {
     glPushMatrix();
     glTranslatef(2.5, 0.0, 0.0);
     if(inFlock) {
-        glRotatef(flockList.at(i).lowerWingAngle, 0.0, 0.0, 1.0);
+        glRotatef(boid.lowerWingAngle, 0.0, 0.0, 1.0);
     }
     else {
         glRotatef(lowerWingAngle, 0.0, 0.0, 1.0);
@@ -519,7 +1863,7 @@ void drawBoid(int i, bool inFlock) {
     glPushMatrix();
     glTranslatef(-3.0, 0.0, 0.0);
     if(inFlock) {
-        glRotatef(-flockList.at(i).upperWingAngle, 0.0, 0.0, 1.0);
+        glRotatef(-boid.upperWingAngle, 0.0, 0.0, 1.0);
     }
     else {
         glRotatef(-upperWingAngle, 0.0, 0.0, 1.0);
@@ -528,7 +1872,7 @@ void drawBoid(int i, bool inFlock) {
     glPushMatrix();
     glTranslatef(-2.5, 0.0, 0.0);
     if(inFlock) {
-        glRotatef(-flockList.at(i).lowerWingAngle, 0.0, 0.0, 1.0);
+        glRotatef(-boid.lowerWingAngle, 0.0, 0.0, 1.0);
     }
     else {
         glRotatef(-lowerWingAngle, 0.0, 0.0, 1.0);
@@ -566,7 +1910,7 @@ void drawAll() {
     glTranslatef(predator.position.x, predator.position.y, predator.position.z);
     glRotatef(modelAngle, 0.0, 1.0, 0.0);
     glColor3f(0.0, 1.0, 0.0);
-    drawBoid(0, false);
+    drawBoid(predator, false);
     glPopMatrix();
     
     vec3df avgPos;
@@ -574,15 +1918,15 @@ void drawAll() {
     
     // Drawing boids
     setMaterial(blueMaterial);
-    for(int i = 0; i < flockList.size(); ++i) {
+    for(int i = 0; i < flockPopulation; ++i) {
         glPushMatrix();
-        Boid boid = flockList.at(i);
+        Boid boid = flockBoid(i);
         glTranslatef(boid.position.x, boid.position.y, boid.position.z);
         avgPos = avgPos + boid.position;
         avgDir = avgDir + boid.direction;
         glRotatef(boid.angle, 0.0, boid.rotation.y, boid.rotation.z);
         glColor3f((float)0/255, (float)0/255, (float)0/255);
-        drawBoid(i, true);
+        drawBoid(boid, true);
         glPopMatrix();
     }
     
@@ -591,7 +1935,7 @@ void drawAll() {
     avgDir = avgDir * COHESION_FACTOR; // Scale for display
     
     for(int i = 0; i < flockPopulation && !lightIsEnabled; i++){
-        Boid s = flockList.at(i);
+        Boid s = flockBoid(i);
         glColor3f(0.0, 1.0, 0.0);
         glBegin(GL_LINES);
         glVertex3f(s.position.x, s.position.y, s.position.z); // Origin of the line
@@ -605,7 +1949,7 @@ void display(SDL_Window* window) {
     glLoadIdentity();
     
     // Set up the camera
-    gluLookAt(0.0, 0.0, 800.0, 
+    gluLookAt(cameraPosition.x, cameraPosition.y, cameraPosition.z, 
               0.0, 0.0, 0.0,
               0.0, 1.0, 0.0);
     updateLightPosition();
@@ -648,6 +1992,49 @@ void handleKeyboard(SDL_Event& event) {
         case SDLK_q:
             exit(EXIT_SUCCESS);
             break;
+        case SDLK_r:
+            // Reports simulation statistics
+            printStats();
+            break;
+        case SDLK_LEFTBRACKET:
+            // Reorders the flock more often
+            reorder.adaptive = false;
+            reorder.interval = max(REORDER_MIN_INTERVAL, reorder.interval / 2);
+            break;
+        case SDLK_RIGHTBRACKET:
+            // Reorders the flock less often
+            reorder.adaptive = false;
+            reorder.interval = min(REORDER_MAX_INTERVAL, reorder.interval * 2);
+            break;
+        case SDLK_k:
+            // Lets the reorder interval follow measured benefit
+            reorder.adaptive = !reorder.adaptive;
+            break;
+        case SDLK_t:
+            // Toggles multi-rate updates
+            multiRate.enabled = !multiRate.enabled;
+            multiRate.schedule.clear();
+            break;
+        case SDLK_b:
+            // Toggles between the bounded box and an open world
+            setOpenWorld(!openWorld);
+            break;
+        case SDLK_n:
+            // Toggles flock analytics
+            setAnalytics(!analytics.enabled);
+            break;
+        case SDLK_c:
+            // Toggles compact flock storage
+            setCompactStorage(!compactStorage);
+            break;
+        case SDLK_MINUS:
+            // Tightens the multi-rate error budget
+            multiRate.errorBudget /= 2.0;
+            break;
+        case SDLK_EQUALS:
+            // Loosens the multi-rate error budget
+            multiRate.errorBudget *= 2.0;
+            break;
         case SDLK_u:
             // Switches between predator and bait
             m2++;
@@ -686,6 +2073,25 @@ void handleKeyboard(SDL_Event& event) {
     }
 }
 
+void flapWings(Boid& b) {
+    if(b.wingRise) {
+        b.upperWingAngle += 6.0;
+        b.lowerWingAngle += 8.0;
+        b.bodyHeight = b.lowerWingAngle/15;
+        if(b.upperWingAngle >= MAX_WING_ANGLE) {
+            b.wingRise = false;
+        }
+    }
+    else {
+        b.upperWingAngle -= 6.0;
+        b.lowerWingAngle -= 8.0;
+        b.bodyHeight = b.lowerWingAngle/15;
+        if(b.upperWingAngle <= 0.0) {
+            b.wingRise = true;
+        }
+    }
+}
+
 void idle() {
     if(!pauseScene) {
         if(wingRise) {
@@ -705,37 +2111,29 @@ void idle() {
             }
         }
         
-        for(int i = 0; i < flockList.size(); ++i) {
-            if(flockList.at(i).wingRise) {
-                flockList.at(i).upperWingAngle += 6.0;
-                flockList.at(i).lowerWingAngle += 8.0;
-                flockList.at(i).bodyHeight = flockList.at(i).lowerWingAngle/15;
-                if(flockList.at(i).upperWingAngle >= MAX_WING_ANGLE) {
-                    flockList.at(i).wingRise = false;
-                }
+        for(int i = 0; i < flockPopulation; ++i) {
+            if(compactStorage) {
+                Boid wings;
+                unpackWings(packedList.at(i).wingPhase, wings);
+                flapWings(wings);
+                packedList.at(i).wingPhase = packWings(wings);
             }
             else {
-                flockList.at(i).upperWingAngle -= 6.0;
-                flockList.at(i).lowerWingAngle -= 8.0;
-                flockList.at(i).bodyHeight = flockList.at(i).lowerWingAngle/15;
-                if(flockList.at(i).upperWingAngle <= 0.0) {
-                    flockList.at(i).wingRise = true;
-                }
+                flapWings(flockList.at(i));
             }
         }
         updateBoids();
     }
 }
 
-int main(int argc, char **argv) {
-    // Global variable initializations
-    GW = WINDOW_WIDTH;
-    GH = WINDOW_HEIGHT;
+// Puts every piece of simulation state back to its startup value and empties
+// the flock, ready for setupFlock()
+void resetSimulation() {
     predator.position.x = predator.position.y = predator.position.z = 0.0;
     m1 = 1; m2 = 0; m3 = 1; // Reset weights
     modelAngle = 0.0;
     pauseScene = false;
-    lightIsEnabled = true;
+    simTick = 0;
     
     // Animation variables
     wingRise = true;
@@ -743,6 +2141,419 @@ int main(int argc, char **argv) {
     lowerWingAngle = -45.0;
     bodyHeight = 0.0;
     
+    // Flock storage
+    flockPopulation = 0;
+    flockList.clear();
+    boidIndex.clear();
+    boidGeneration.clear();
+    freeIds.clear();
+    compactStorage = false;
+    packedList.clear();
+    packing = Packing();
+    openWorld = false;
+    paging.frozen.clear();
+    paging.frozenBoids = 0;
+    paging.pagedOut = 0;
+    paging.pagedIn = 0;
+    neighbors.valid = false;
+    neighbors.builds = 0;
+    neighbors.ticks = 0;
+    neighbors.buildMs = 0.0;
+    reorder.adaptive = true;
+    reorder.interval = REORDER_INTERVAL;
+    reorder.ticksSince = 0;
+    reorder.earlyMs = reorder.earlySq = 0.0;
+    reorder.lateMs = reorder.lateSq = 0.0;
+    reorder.sortMs = 0.0;
+    reorder.count = 0;
+    multiRate.enabled = false;
+    multiRate.errorBudget = MULTIRATE_ERROR_BUDGET;
+    multiRate.schedule.clear();
+    multiRate.evaluations = 0;
+    multiRate.skipped = 0;
+    analytics.enabled = false;
+    analytics.latest = FlockMetrics();
+    analytics.onMs = analytics.offMs = 0.0;
+    analytics.onTicks = analytics.offTicks = 0;
+}
+
+// ============================================================================
+// Scenarios
+// ============================================================================
+
+// A scenario file sets up a flock with "seed N", "boids N" and "ticks N" and
+// then lists "<tick> <command> [args]" lines, applied just before that tick is
+// simulated:
+//   predator x y z      place the predator
+//   move x y z n        glide the predator to x y z over n ticks
+//   mode attract|neutral|repel
+//   scatter on|off
+//   pause, resume
+//   spawn n [x y z]     add boids, around x y z when given
+//   kill n
+//   catch r             the predator removes boids within r (0 stops it)
+//   compact on|off, multirate on|off, analytics on|off
+//   world open|bounded
+// Blank lines and text after '#' are ignored.
+enum ScenarioAction {
+    ACTION_PREDATOR, ACTION_MOVE, ACTION_MODE, ACTION_SCATTER, ACTION_PAUSE,
+    ACTION_RESUME, ACTION_SPAWN, ACTION_EMIT, ACTION_KILL, ACTION_CATCH,
+    ACTION_COMPACT, ACTION_MULTIRATE, ACTION_ANALYTICS, ACTION_WORLD
+};
+
+struct ScenarioCommand {
+    long tick;
+    ScenarioAction action;
+    vec3df target;
+    int amount;  // glide ticks, boid count, radius, m2 weight or on/off flag
+};
+
+struct Scenario {
+    string name;
+    unsigned seed;
+    int boids;
+    long ticks;
+    vector<ScenarioCommand> commands;
+    
+    // Playback state
+    size_t next;
+    long tick;
+    vec3df moveFrom, moveTo;
+    long moveStart, moveTicks;
+    float catchRadius;
+    vector<BoidHandle> caught;      // boids caught last tick, removed this tick
+};
+
+const char* standardScenarios[] = {
+    "scenarios/cruise.scn",
+    "scenarios/predator_dive.scn",
+    "scenarios/attractor_crush.scn",
+    "scenarios/scatter_regroup.scn",
+    "scenarios/population_churn.scn",
+    "scenarios/emitter_catch.scn",
+    "scenarios/large_flock.scn",
+    "scenarios/open_world.scn"
+};
+
+Scenario scenario;
+bool scenarioPlaying = false;
+
+bool parseSwitch(istringstream& in, int& flag) {
+    string value;
+    in >> value;
+    flag = (value == "on");
+    return value == "on" || value == "off";
+}
+
+// True when nothing but whitespace is left on the line
+bool atLineEnd(istringstream& in) {
+    string extra;
+    return !(in >> extra);
+}
+
+bool loadScenario(const string& path, Scenario& sc) {
+    ifstream file(path.c_str());
+    if(!file) {
+        std::cerr << path << ": could not open scenario" << std::endl;
+        return false;
+    }
+    
+    size_t slash = path.find_last_of('/');
+    sc.name = path.substr(slash == string::npos ? 0 : slash + 1);
+    sc.seed = 1;
+    sc.boids = BOIDSCOUNT;
+    sc.ticks = 600;
+    sc.commands.clear();
+    
+    string line;
+    for(int lineNo = 1; getline(file, line); ++lineNo) {
+        line = line.substr(0, line.find('#'));
+        istringstream in(line);
+        string word;
+        if(!(in >> word)) {
+            continue;
+        }
+        
+        bool ok = true;
+        if(word == "seed") {
+            ok = bool(in >> sc.seed);
+        }
+        else if(word == "boids") {
+            ok = bool(in >> sc.boids) && sc.boids >= 2;
+        }
+        else if(word == "ticks") {
+            ok = bool(in >> sc.ticks);
+        }
+        else {
+            ScenarioCommand cmd;
+            cmd.amount = 0;
+            istringstream tickIn(word);
+            string action;
+            if(!(tickIn >> cmd.tick) || !atLineEnd(tickIn) || !(in >> action)) {
+                ok = false;
+            }
+            else if(action == "predator") {
+                cmd.action = ACTION_PREDATOR;
+                ok = bool(in >> cmd.target.x >> cmd.target.y >> cmd.target.z);
+            }
+            else if(action == "move") {
+                cmd.action = ACTION_MOVE;
+                ok = bool(in >> cmd.target.x >> cmd.target.y >> cmd.target.z >> cmd.amount) && cmd.amount > 0;
+            }
+            else if(action == "mode") {
+                string mode;
+                in >> mode;
+                cmd.action = ACTION_MODE;
+                cmd.amount = mode == "attract" ? 1 : (mode == "repel" ? -1 : 0);
+                ok = mode == "attract" || mode == "neutral" || mode == "repel";
+            }
+            else if(action == "scatter") {
+                cmd.action = ACTION_SCATTER;
+                ok = parseSwitch(in, cmd.amount);
+            }
+            else if(action == "pause") {
+                cmd.action = ACTION_PAUSE;
+            }
+            else if(action == "resume") {
+                cmd.action = ACTION_RESUME;
+            }
+            else if(action == "spawn") {
+                cmd.action = ACTION_SPAWN;
+                ok = bool(in >> cmd.amount) && cmd.amount >= 0;
+                if(ok && !(in >> ws).eof()) {
+                    cmd.action = ACTION_EMIT;
+                    ok = bool(in >> cmd.target.x >> cmd.target.y >> cmd.target.z);
+                }
+            }
+            else if(action == "kill" || action == "catch") {
+                cmd.action = action == "kill" ? ACTION_KILL : ACTION_CATCH;
+                ok = bool(in >> cmd.amount) && cmd.amount >= 0;
+            }
+            else if(action == "compact") {
+                cmd.action = ACTION_COMPACT;
+                ok = parseSwitch(in, cmd.amount);
+            }
+            else if(action == "multirate") {
+                cmd.action = ACTION_MULTIRATE;
+                ok = parseSwitch(in, cmd.amount);
+            }
+            else if(action == "analytics") {
+                cmd.action = ACTION_ANALYTICS;
+                ok = parseSwitch(in, cmd.amount);
+            }
+            else if(action == "world") {
+                string world;
+                in >> world;
+                cmd.action = ACTION_WORLD;
+                cmd.amount = (world == "open");
+                ok = world == "open" || world == "bounded";
+            }
+            else {
+                ok = false;
+            }
+            
+            ok = ok && atLineEnd(in);
+            if(ok) {
+                sc.commands.push_back(cmd);
+            }
+        }
+        ok = ok && atLineEnd(in);
+        
+        if(!ok) {
+            std::cerr << path << ":" << lineNo << ": bad scenario line: " << line << std::endl;
+            return false;
+        }
+    }
+    
+    stable_sort(sc.commands.begin(), sc.commands.end(),
+                [](const ScenarioCommand& a, const ScenarioCommand& b) { return a.tick < b.tick; });
+    sc.next = 0;
+    sc.tick = 0;
+    sc.moveTicks = 0;
+    sc.catchRadius = 0.0;
+    return true;
+}
+
+// Resets the simulation to the scenario's starting flock. Morton reordering
+// runs at a fixed interval, since an interval driven by timings would change
+// the update order from run to run.
+void startScenario(Scenario& sc) {
+    resetSimulation();
+    reorder.adaptive = false;
+    setupFlock(sc.boids, sc.seed);
+    sc.next = 0;
+    sc.tick = 0;
+    sc.moveTicks = 0;
+    sc.catchRadius = 0.0;
+    sc.caught.clear();
+}
+
+void applyScenarioCommand(Scenario& sc, const ScenarioCommand& cmd) {
+    switch(cmd.action) {
+        case ACTION_PREDATOR:
+            predator.position = cmd.target;
+            sc.moveTicks = 0;
+            break;
+        case ACTION_MOVE:
+            sc.moveFrom = predator.position;
+            sc.moveTo = cmd.target;
+            sc.moveStart = sc.tick;
+            sc.moveTicks = cmd.amount;
+            break;
+        case ACTION_MODE:
+            m2 = cmd.amount;
+            break;
+        case ACTION_SCATTER:
+            m1 = cmd.amount ? -1 : 1;
+            break;
+        case ACTION_PAUSE:
+            m3 = 0;
+            pauseScene = true;
+            break;
+        case ACTION_RESUME:
+            m3 = 1;
+            pauseScene = false;
+            break;
+        case ACTION_SPAWN:
+            spawnBoids(cmd.amount);
+            break;
+        case ACTION_EMIT:
+            spawnBoids(cmd.amount, &cmd.target);
+            break;
+        case ACTION_KILL:
+            killBoids(cmd.amount);
+            break;
+        case ACTION_CATCH:
+            sc.catchRadius = cmd.amount;
+            break;
+        case ACTION_COMPACT:
+            setCompactStorage(cmd.amount != 0);
+            break;
+        case ACTION_MULTIRATE:
+            multiRate.enabled = cmd.amount != 0;
+            multiRate.schedule.clear();
+            break;
+        case ACTION_ANALYTICS:
+            setAnalytics(cmd.amount != 0);
+            break;
+        case ACTION_WORLD:
+            setOpenWorld(cmd.amount != 0);
+            break;
+    }
+}
+
+// Applies everything due at the scenario's current tick; call once per idle()
+void applyScenarioTick(Scenario& sc) {
+    while(sc.next < sc.commands.size() && sc.commands[sc.next].tick <= sc.tick) {
+        applyScenarioCommand(sc, sc.commands[sc.next]);
+        sc.next++;
+    }
+    
+    if(sc.moveTicks > 0) {
+        long elapsed = sc.tick - sc.moveStart + 1;
+        predator.position = sc.moveFrom + (sc.moveTo - sc.moveFrom) * (float(elapsed) / sc.moveTicks);
+        if(elapsed >= sc.moveTicks) {
+            sc.moveTicks = 0;
+        }
+    }
+    
+    // Boids caught last tick are removed now. Any that this tick's commands
+    // already killed have stale handles, even if a spawn reused their ids.
+    for(size_t k = 0; k < sc.caught.size() && flockPopulation > 2; ++k) {
+        killBoid(sc.caught[k]);
+    }
+    sc.caught.clear();
+    for(int i = 0; i < flockPopulation && sc.catchRadius > 0; ++i) {
+        if(distBetween(boidPosition(i), predator.position) < sc.catchRadius) {
+            sc.caught.push_back(boidHandle(i));
+        }
+    }
+    
+    sc.tick++;
+}
+
+// Order-sensitive sum of the flock state, so identical runs print identical values
+double flockChecksum() {
+    double sum = 0.0;
+    for(int i = 0; i < flockPopulation; ++i) {
+        vec3df p = boidPosition(i);
+        sum += (i + 1) * (p.x + 2.0 * p.y + 3.0 * p.z);
+    }
+    return sum;
+}
+
+// Plays each scenario headless and reports its timing
+int runScenarios(const vector<string>& paths) {
+    vector<Scenario> scenarios(paths.size());
+    for(size_t s = 0; s < paths.size(); ++s) {
+        if(!loadScenario(paths[s], scenarios[s])) {
+            return 1;
+        }
+    }
+    
+    std::cout << "scenario                  boids  ticks   total ms  ms/tick  worst ms  checksum" << std::endl;
+    for(size_t s = 0; s < scenarios.size(); ++s) {
+        Scenario& sc = scenarios[s];
+        startScenario(sc);
+        
+        double total = 0.0, worst = 0.0;
+        for(long t = 0; t < sc.ticks; ++t) {
+            // Population changes and catches are part of the work being measured
+            chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+            applyScenarioTick(sc);
+            idle();
+            double ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+            total += ms;
+            worst = max(worst, ms);
+        }
+        
+        char row[160];
+        snprintf(row, sizeof(row), "%-24s %6d %6ld %10.1f %8.3f %9.3f  %.6e",
+                 sc.name.c_str(), flockPopulation, sc.ticks, total,
+                 sc.ticks > 0 ? total / sc.ticks : 0.0, worst, flockChecksum());
+        std::cout << row << std::endl;
+    }
+    
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    // Command line: headless scenario runs or windowed playback
+    vector<string> scenarioPaths;
+    string playPath;
+    for(int a = 1; a < argc; ++a) {
+        string arg = argv[a];
+        if(arg == "--bench") {
+            scenarioPaths.insert(scenarioPaths.end(), standardScenarios,
+                                 standardScenarios + sizeof(standardScenarios) / sizeof(standardScenarios[0]));
+        }
+        else if(arg == "--scenario" && a + 1 < argc) {
+            scenarioPaths.push_back(argv[++a]);
+        }
+        else if(arg == "--play" && a + 1 < argc) {
+            playPath = argv[++a];
+        }
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--bench] [--scenario file]... [--play file]" << std::endl;
+            return 1;
+        }
+    }
+    if(!scenarioPaths.empty()) {
+        return runScenarios(scenarioPaths);
+    }
+    if(!playPath.empty()) {
+        if(!loadScenario(playPath, scenario)) {
+            return 1;
+        }
+        scenarioPlaying = true;
+    }
+    
+    // Global variable initializations
+    GW = WINDOW_WIDTH;
+    GH = WINDOW_HEIGHT;
+    lightIsEnabled = true;
+    resetSimulation();
+    
     // Initialize SDL
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         std::cerr << "SDL could not initialize! SDL_Error: " << SDL_GetError() << std::endl;
@@ -782,8 +2593,14 @@ int main(int argc, char **argv) {
     initLighting();
     
     // Setup flock population
-    setupFlock(BOIDSCOUNT);
-    std::cout << "Boids simulation initialized with " << BOIDSCOUNT << " boids" << std::endl;
+    if(scenarioPlaying) {
+        startScenario(scenario);
+        std::cout << "Playing scenario " << scenario.name << std::endl;
+    }
+    else {
+        setupFlock(BOIDSCOUNT, time(NULL));
+    }
+    std::cout << "Boids simulation initialized with " << flockPopulation << " boids" << std::endl;
     
     // Initial reshape
     reshape(WINDOW_WIDTH, WINDOW_HEIGHT);
@@ -809,6 +2626,9 @@ int main(int argc, char **argv) {
         }
         
         // Update simulation
+        if(scenarioPlaying && scenario.tick < scenario.ticks) {
+            applyScenarioTick(scenario);
+        }
         idle();
         
         // Render